@@ -2,21 +2,44 @@
 
 #include "common.h"
 #include "FifoCircularMessageBuffer.h"
+#include "ReceiveDispatcher.h"
 
 template<typename SocketType, typename MessageQueueType>
 class CoRoutineSocketSenderAndReceiver {
 public:
-    CoRoutineSocketSenderAndReceiver(SocketType socket, MessageCallback on_msg_callback = nullptr) :
+    /**
+     * @param dispatcher Optional. When set received messages are handed to its worker threads instead of
+     *                   calling on_msg_callback on the io thread. See ReceiveDispatcher
+     */
+    CoRoutineSocketSenderAndReceiver(SocketType socket,
+                                     MessageCallback on_msg_callback = nullptr,
+                                     ReceiveDispatcher *dispatcher = nullptr) :
             socket_(std::move(socket)),
             timer_(socket_.get_executor()),
-            on_received_message_callback_(std::move(on_msg_callback)) {
+            backpressure_timer_(socket_.get_executor()),
+            on_received_message_callback_(std::move(on_msg_callback)),
+            dispatcher_(dispatcher) {
         if (!on_received_message_callback_) {
             // No op - instead of conditional null check every msg - small perf improvement
             this->on_received_message_callback_ = [&](const char *, size_t) {};
         }
+        if (dispatcher_) {
+            dispatch_key_ = dispatcher_->next_key();
+            read_buffer_count_ = dispatcher_->buffers_per_connection();
+            read_buffers_ = std::make_unique<ReadBuffer[]>(read_buffer_count_);
+        }
         timer_.expires_at(std::chrono::steady_clock::time_point::max());
     }
 
+    virtual ~CoRoutineSocketSenderAndReceiver() {
+        // Workers may still be running callbacks on our read buffers
+        for (size_t i = 0; i < read_buffer_count_; ++i) {
+            while (read_buffers_[i].in_use.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
     void send(const std::string_view &msg) {
         if (msgs_to_send_.push(msg)) {
             timer_.cancel_one(); // signal writer co_routine waiting on timer
@@ -56,7 +79,7 @@ protected:
     virtual void start() {
         // Start a co_routine to read
         co_spawn(socket_.get_executor(),
-                 [&] { return reader(); },
+                 [&] { return dispatcher_ ? dispatching_reader() : reader(); },
                  detached);
 
         // Start a co_routine to write
@@ -68,13 +91,29 @@ protected:
 
     void stop() {
         timer_.cancel();
+        backpressure_timer_.cancel();
         socket_.close();
     }
 
 private:
+    static constexpr std::chrono::microseconds BACKPRESSURE_RETRY_INTERVAL{50};
+
+    /**
+     * Read into by the io thread, then handed to a dispatcher worker until it clears in_use
+     */
+    struct ReadBuffer {
+        char data[READ_BUFFER_SIZE] = {};
+        std::atomic<bool> in_use{false};
+    };
+
     asio::steady_timer timer_; // used for synchronization and signaling
+    asio::steady_timer backpressure_timer_; // used to pause reads while the dispatcher is full
     MessageCallback on_received_message_callback_;
     MessageQueueType msgs_to_send_;
+    ReceiveDispatcher *dispatcher_;
+    uint64_t dispatch_key_ = 0;
+    size_t read_buffer_count_ = 0;
+    std::unique_ptr<ReadBuffer[]> read_buffers_;
 
     awaitable<void> reader() {
         try {
@@ -91,6 +130,57 @@ private:
         }
     }
 
+    /**
+     * reader() for when a dispatcher is set. The io thread only reads, the callback runs on a dispatcher worker.
+     *
+     * Read buffers are used round robin and are not reused until the worker is done with them.
+     * Backpressure: if the next buffer is still in use, or the dispatcher ring is full, we stop reading
+     * the socket and retry every BACKPRESSURE_RETRY_INTERVAL. Nothing is dropped here - unread data
+     * waits in the kernel socket buffer (TCP flow control kicks in, UDP drops once that buffer is full).
+     */
+    awaitable<void> dispatching_reader() {
+        try {
+            for (size_t next = 0;; next = (next + 1) % read_buffer_count_) {
+                ReadBuffer &buffer = read_buffers_[next];
+                while (buffer.in_use.load(std::memory_order_acquire)) {
+                    co_await wait_for_dispatcher();
+                }
+
+                // co_await
+                // wake up signal: when bytes are available on the socket
+                std::size_t n = co_await do_read(asio::buffer(buffer.data));
+
+                ReceivedMessage msg{buffer.data, n, &on_received_message_callback_, &buffer.in_use};
+                if (!dispatch(msg)) {
+                    std::cerr << "Receive dispatcher full. Pausing reads." << std::endl;
+                    do {
+                        co_await wait_for_dispatcher();
+                    } while (!dispatch(msg));
+                }
+            }
+        } catch (std::exception &e) {
+            std::cerr << "Exception while reading: " << e.what() << std::endl;
+            stop();
+        }
+    }
+
+    /**
+     * in_use is only left set if the worker now owns the buffer
+     */
+    bool dispatch(const ReceivedMessage &msg) {
+        msg.in_use->store(true, std::memory_order_relaxed);
+        if (dispatcher_->dispatch(dispatch_key_, msg)) {
+            return true;
+        }
+        msg.in_use->store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    awaitable<void> wait_for_dispatcher() {
+        backpressure_timer_.expires_after(BACKPRESSURE_RETRY_INTERVAL);
+        co_await backpressure_timer_.async_wait(use_awaitable);
+    }
+
     awaitable<void> writer() {
         try {
             while (socket_.is_open()) {
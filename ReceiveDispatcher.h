@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * A received message handed from the io thread to a worker.
+ *
+ * Nothing is copied: data points into a read buffer owned by the connection that read it.
+ * The worker runs the callback and then clears in_use, which hands the buffer back to that connection's reader.
+ */
+struct ReceivedMessage {
+    const char *data = nullptr;
+    size_t len = 0;
+    const MessageCallback *callback = nullptr;
+    std::atomic<bool> *in_use = nullptr;
+};
+
+/**
+ * A bounded single producer single consumer ring of ReceivedMessage.
+ *
+ * Capacity is rounded up to a power of two. Read and write positions only ever increase
+ * and are kept on separate cache lines so the producer and consumer do not false share.
+ */
+class ReceivedMessageRing {
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    size_t mask_;
+    std::vector<ReceivedMessage> data_;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> read_{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_{0};
+
+    static size_t round_up_to_power_of_two(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+public:
+    explicit ReceivedMessageRing(size_t capacity) :
+            mask_(round_up_to_power_of_two(capacity) - 1),
+            data_(mask_ + 1) {
+    }
+
+    /**
+     * @return False if the ring is full
+     */
+    bool push(const ReceivedMessage &msg) {
+        uint64_t cur_write = write_.load(std::memory_order_relaxed);
+        if (cur_write - read_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        data_[cur_write & mask_] = msg;
+        write_.store(cur_write + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return False if nothing to pop
+     */
+    bool pop(ReceivedMessage &msg) {
+        uint64_t cur_read = read_.load(std::memory_order_relaxed);
+        if (cur_read == write_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        msg = data_[cur_read & mask_];
+        read_.store(cur_read + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * Moves on_received_message callbacks off the io thread and onto a pool of worker threads.
+ *
+ * Connections are sharded by key onto a fixed set of rings. Each ring is owned by one worker
+ * (shard % num_workers) and fed by the io thread. A worker must claim a ring before popping from it
+ * and holds the claim while the callback runs, so a ring only ever has one consumer at a time and
+ * messages from one connection are handled in the order they were read.
+ * A worker with nothing to do on its own rings steals whole rings from the other workers. With more
+ * shards than workers one slow callback only holds up the connections sharing its ring.
+ *
+ * Backpressure: dispatch() returns false when the connection's ring is full. The reader then stops
+ * reading that socket until the workers catch up (see CoRoutineSocketSenderAndReceiver::dispatching_reader).
+ *
+ * Requirements:
+ *      every connection using a dispatcher must be read on the same thread (e.g.: asio::io_context(1))
+ *      callbacks may be called concurrently for different connections and must be thread safe
+ *      the dispatcher must outlive every connection using it
+ */
+class ReceiveDispatcher {
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t MAX_BATCH_SIZE = 32;    // messages handled per claim before the ring is offered up
+    static constexpr size_t SPINS_BEFORE_YIELD = 1024;
+    static constexpr size_t YIELDS_BEFORE_SLEEP = 64;
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        ReceivedMessageRing ring;
+        std::atomic<bool> claimed{false};
+
+        explicit Shard(size_t ring_capacity) : ring(ring_capacity) {}
+    };
+
+    size_t num_workers_;
+    size_t buffers_per_connection_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> next_key_{0};
+    std::atomic<bool> running_{true};
+    std::vector<std::thread> workers_;
+
+public:
+    /**
+     * @param num_workers               Worker threads to run callbacks on
+     * @param shards_per_worker         Rings per worker. More rings: finer stealing, less head of line blocking
+     * @param ring_capacity             Messages each ring can hold before dispatch() reports backpressure
+     * @param buffers_per_connection    Read buffers each connection cycles through while its messages are in flight
+     */
+    explicit ReceiveDispatcher(size_t num_workers,
+                               size_t shards_per_worker = 4,
+                               size_t ring_capacity = 1024,
+                               size_t buffers_per_connection = 64) :
+            num_workers_(num_workers),
+            buffers_per_connection_(buffers_per_connection) {
+        if (num_workers_ == 0 || shards_per_worker == 0 || ring_capacity == 0 || buffers_per_connection_ == 0) {
+            throw std::runtime_error("ReceiveDispatcher: workers, shards, ring capacity and buffers must be > 0");
+        }
+        for (size_t i = 0; i < num_workers_ * shards_per_worker; ++i) {
+            shards_.push_back(std::make_unique<Shard>(ring_capacity));
+        }
+        for (size_t worker = 0; worker < num_workers_; ++worker) {
+            workers_.emplace_back([this, worker] { run_worker(worker); });
+        }
+    }
+
+    ReceiveDispatcher(const ReceiveDispatcher &) = delete;
+
+    ReceiveDispatcher &operator=(const ReceiveDispatcher &) = delete;
+
+    /**
+     * Stops the workers once every message already dispatched has been handled
+     */
+    ~ReceiveDispatcher() {
+        running_.store(false, std::memory_order_release);
+        for (auto &&worker : workers_) {
+            worker.join();
+        }
+    }
+
+    /**
+     * @return A key for a new connection. Keys are handed out round robin across the shards
+     */
+    uint64_t next_key() {
+        return next_key_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t buffers_per_connection() const {
+        return buffers_per_connection_;
+    }
+
+    /**
+     * Called from the io thread only.
+     *
+     * @return False if the ring for key is full. Nothing is queued and msg.in_use is left untouched
+     */
+    bool dispatch(uint64_t key, const ReceivedMessage &msg) {
+        return shards_[key % shards_.size()]->ring.push(msg);
+    }
+
+private:
+
+    void run_worker(size_t worker) {
+        size_t idle = 0;
+        while (running_.load(std::memory_order_acquire)) {
+            if (run_once(worker)) {
+                idle = 0;
+            } else {
+                backoff(idle++);
+            }
+        }
+        // Drain whatever the io thread queued before we were asked to stop
+        while (run_once(worker)) {
+        }
+    }
+
+    /**
+     * Services this worker's own rings first, then tries to steal from the others
+     *
+     * @return True if any message was handled
+     */
+    bool run_once(size_t worker) {
+        bool did_work = false;
+        for (size_t i = worker; i < shards_.size(); i += num_workers_) {
+            did_work |= drain(*shards_[i]);
+        }
+        if (did_work) {
+            return true;
+        }
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            if (i % num_workers_ != worker) {
+                did_work |= drain(*shards_[i]);
+            }
+        }
+        return did_work;
+    }
+
+    static bool drain(Shard &shard) {
+        if (shard.claimed.load(std::memory_order_relaxed) ||
+            shard.claimed.exchange(true, std::memory_order_acquire)) {
+            return false;
+        }
+        size_t handled = 0;
+        ReceivedMessage msg;
+        while (handled < MAX_BATCH_SIZE && shard.ring.pop(msg)) {
+            try {
+                (*msg.callback)(msg.data, msg.len);
+            } catch (std::exception &e) {
+                std::cerr << "Exception in received message callback: " << e.what() << std::endl;
+            }
+            msg.in_use->store(false, std::memory_order_release);
+            ++handled;
+        }
+        shard.claimed.store(false, std::memory_order_release);
+        return handled > 0;
+    }
+
+    static void backoff(size_t idle) {
+        if (idle < SPINS_BEFORE_YIELD) {
+            return;
+        }
+        if (idle < SPINS_BEFORE_YIELD + YIELDS_BEFORE_SLEEP) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
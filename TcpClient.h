@@ -12,8 +12,9 @@ public:
               const std::string &ip_address,
               uint16_t port,
               const std::string &bind_address = "0.0.0.0",
-              MessageCallback onMsgCallback = nullptr)
-            : CoRoutineSocketSenderAndReceiver(tcp::socket(io_context), std::move(onMsgCallback)) {
+              MessageCallback onMsgCallback = nullptr,
+              ReceiveDispatcher *dispatcher = nullptr)
+            : CoRoutineSocketSenderAndReceiver(tcp::socket(io_context), std::move(onMsgCallback), dispatcher) {
         connect(ip_address, port, bind_address);
     }
 
@@ -10,8 +10,10 @@
 class TcpServerConnection
         : public CoRoutineSocketSenderAndReceiver<tcp::socket, FifoCircularMessageBuffer<std::string_view>> {
 public:
-    TcpServerConnection(tcp::socket socket, MessageCallback onMsgCallback = nullptr)
-            : CoRoutineSocketSenderAndReceiver(std::move(socket), std::move(onMsgCallback)) {
+    TcpServerConnection(tcp::socket socket,
+                        MessageCallback onMsgCallback = nullptr,
+                        ReceiveDispatcher *dispatcher = nullptr)
+            : CoRoutineSocketSenderAndReceiver(std::move(socket), std::move(onMsgCallback), dispatcher) {
         std::cout << "New TcpConnection from: " << socket_.remote_endpoint()
                   << " connected at: " << socket_.local_endpoint() << std::endl;
         start();
@@ -39,8 +41,10 @@ public:
     explicit TcpServer(asio::io_context &io_context,
                        const std::string &ip_address,
                        uint16_t port,
-                       MessageCallback messageCallback = nullptr) :
-            messageCallback(std::move(messageCallback)) {
+                       MessageCallback messageCallback = nullptr,
+                       ReceiveDispatcher *dispatcher = nullptr) :
+            messageCallback(std::move(messageCallback)),
+            dispatcher(dispatcher) {
         std::cout << "Accepting new connections at " << ip_address << ":" << std::to_string(port) << std::endl;
         co_spawn(io_context,
                  create_listener(tcp::acceptor(io_context,
@@ -56,6 +60,7 @@ public:
 
 private:
     MessageCallback messageCallback;
+    ReceiveDispatcher *dispatcher;
     std::vector<std::shared_ptr<TcpServerConnection>> connections;
 
     awaitable<void>
@@ -63,7 +68,8 @@ private:
         for (;;) {
             const std::shared_ptr<TcpServerConnection> &serverPtr = std::make_shared<TcpServerConnection>(
                     co_await acceptor.async_accept(use_awaitable),
-                    messageCallback
+                    messageCallback,
+                    dispatcher
             );
             connections.push_back(serverPtr);
         }
@@ -11,8 +11,10 @@ public:
     UdpClient(asio::io_context &io_context,
               const std::string &multicast_group,
               uint16_t multicast_port,
-              const std::string &bind_address = "0.0.0.0") : // bind_address = "0.0.0.0" = all
-            CoRoutineSocketSenderAndReceiver(udp::socket(io_context)),
+              const std::string &bind_address = "0.0.0.0", // bind_address = "0.0.0.0" = all
+              MessageCallback onMsgCallback = nullptr,
+              ReceiveDispatcher *dispatcher = nullptr) :
+            CoRoutineSocketSenderAndReceiver(udp::socket(io_context), std::move(onMsgCallback), dispatcher),
             receiving_endpoint_(create_endpoint<udp::endpoint>(bind_address, 0)),  // port = 0 = any port
             multicast_endpoint_(create_endpoint<udp::endpoint>(multicast_group, multicast_port)) {
         std::cout << "Will join multicast group: " << multicast_endpoint_
@@ -12,7 +12,10 @@ int main(int argc, char *argv[]) {
         asio::signal_set signals(io_context, SIGINT, SIGTERM);
         signals.async_wait([&](auto, auto) { io_context.stop(); });
 
-        TcpServer server(io_context, config.ip, config.port);
+        // Received messages are handled on 2 worker threads so a slow callback can not stall the io thread
+        ReceiveDispatcher dispatcher(2);
+
+        TcpServer server(io_context, config.ip, config.port, on_msgs_received, &dispatcher);
 
         // Every 5 secs send a msgs from another thread to all connected sockets
         std::thread sendingThread([&] {